@@ -0,0 +1,141 @@
+/* ModbusCache
+
+Copyright 2018 Bert Melis
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <string.h>  // for memcpy
+
+#include "ModbusCache.h"
+
+namespace esp32ModbusTCPInternals {
+
+bool ModbusCacheItem::isFresh(uint32_t now) {
+  return (valid && now - lastMillis < ttl);  // safe for millis() rollover
+}
+
+ModbusCache::ModbusCache() :
+  _items(),
+  _numberItems(0),
+  _lock(nullptr) {
+    _lock = xSemaphoreCreateMutex();
+  }
+
+ModbusCache::~ModbusCache() {
+  for (uint8_t i = 0; i < _numberItems; ++i) {
+    delete[] _items[i].data;
+  }
+  vSemaphoreDelete(_lock);
+}
+
+bool ModbusCache::add(esp32Modbus::FunctionCode functionCode, uint16_t address, uint16_t byteCount, uint32_t ttl) {
+  if (byteCount == 0 || byteCount > MB_CACHE_MAX_BYTES) return false;
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  if (_numberItems == MB_NUMBER_CACHE_ITEMS || find(functionCode, address, byteCount)) {
+    xSemaphoreGive(_lock);
+    return false;
+  }
+  ModbusCacheItem* item = &_items[_numberItems];
+  item->functionCode = functionCode;
+  item->address = address;
+  item->byteCount = byteCount;
+  item->ttl = ttl;
+  item->lastMillis = 0;
+  item->valid = false;
+  item->packetId = 0;
+  item->data = new uint8_t[byteCount];
+  ++_numberItems;  // only visible to find() when completely set up
+  xSemaphoreGive(_lock);
+  return true;
+}
+
+ModbusCacheItem* ModbusCache::find(esp32Modbus::FunctionCode functionCode, uint16_t address, uint16_t byteCount) {
+  for (uint8_t i = 0; i < _numberItems; ++i) {
+    if (_items[i].functionCode == functionCode &&
+        _items[i].address == address &&
+        _items[i].byteCount == byteCount) {
+      return &_items[i];
+    }
+  }
+  return nullptr;
+}
+
+ModbusCache::Result ModbusCache::attach(ModbusCacheItem* item, uint16_t* packetId, uint32_t now, bool allowFresh) {
+  Result result = MISS;
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  if (allowFresh && item->isFresh(now)) {
+    result = FRESH;
+  } else if (item->packetId > 0) {
+    *packetId = item->packetId;
+    result = PENDING;
+  } else {
+    item->packetId = *packetId;
+  }
+  xSemaphoreGive(_lock);
+  return result;
+}
+
+size_t ModbusCache::copy(ModbusCacheItem* item, uint8_t* buffer) {
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  memcpy(buffer, item->data, item->byteCount);
+  xSemaphoreGive(_lock);
+  return item->byteCount;
+}
+
+bool ModbusCache::copyFresh(ModbusCacheItem* item, uint8_t* buffer, uint32_t now) {
+  bool fresh = false;
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  if (item->isFresh(now)) {
+    memcpy(buffer, item->data, item->byteCount);
+    fresh = true;
+  }
+  xSemaphoreGive(_lock);
+  return fresh;
+}
+
+void ModbusCache::store(uint16_t packetId, uint8_t* data, size_t length, uint32_t now) {
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  for (uint8_t i = 0; i < _numberItems; ++i) {
+    if (_items[i].packetId == packetId) {
+      if (length == _items[i].byteCount) {
+        memcpy(_items[i].data, data, length);
+        _items[i].lastMillis = now;
+        _items[i].valid = true;
+      }
+      _items[i].packetId = 0;
+      break;
+    }
+  }
+  xSemaphoreGive(_lock);
+}
+
+void ModbusCache::release(uint16_t packetId) {
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  for (uint8_t i = 0; i < _numberItems; ++i) {
+    if (_items[i].packetId == packetId) {
+      _items[i].packetId = 0;
+      break;
+    }
+  }
+  xSemaphoreGive(_lock);
+}
+
+}  // namespace esp32ModbusTCPInternals
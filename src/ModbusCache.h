@@ -0,0 +1,89 @@
+/* ModbusCache
+
+Copyright 2018 Bert Melis
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef esp32ModbusTCPInternals_ModbusCache_h
+#define esp32ModbusTCPInternals_ModbusCache_h
+
+#include <stdint.h>  // for uint*_t
+#include <stddef.h>  // for size_t
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include "esp32ModbusTypeDefs.h"
+
+#ifndef MB_NUMBER_CACHE_ITEMS
+#define MB_NUMBER_CACHE_ITEMS 8  // number of register ranges that can be cached
+#endif
+#define MB_CACHE_MAX_BYTES 250  // 125 registers, maximum for one read
+
+namespace esp32ModbusTCPInternals {
+
+// fields other than the key are only accessed by ModbusCache, under its lock
+struct ModbusCacheItem {
+  bool isFresh(uint32_t now);
+  esp32Modbus::FunctionCode functionCode;
+  uint16_t address;
+  uint16_t byteCount;
+  uint32_t ttl;
+  uint32_t lastMillis;
+  bool valid;
+  uint16_t packetId;  // id of the request in the queue for this range, 0 if none
+  uint8_t* data;
+};
+
+// cached reply waiting to be delivered
+struct ModbusCacheReply {
+  uint16_t packetId;
+  ModbusCacheItem* item;
+};
+
+class ModbusCache {
+ public:
+  enum Result : uint8_t {
+    MISS,     // request has to be sent, packet ID is attached to the item
+    FRESH,    // cached data can be used
+    PENDING   // identical request is waiting, packet ID is set to its ID
+  };
+  ModbusCache();
+  ~ModbusCache();
+  ModbusCache(const ModbusCache&) = delete;
+  ModbusCache& operator=(const ModbusCache&) = delete;
+  bool add(esp32Modbus::FunctionCode functionCode, uint16_t address, uint16_t byteCount, uint32_t ttl);
+  ModbusCacheItem* find(esp32Modbus::FunctionCode functionCode, uint16_t address, uint16_t byteCount);
+  Result attach(ModbusCacheItem* item, uint16_t* packetId, uint32_t now, bool allowFresh);
+  size_t copy(ModbusCacheItem* item, uint8_t* buffer);  // buffer holds MB_CACHE_MAX_BYTES
+  bool copyFresh(ModbusCacheItem* item, uint8_t* buffer, uint32_t now);
+  void store(uint16_t packetId, uint8_t* data, size_t length, uint32_t now);
+  void release(uint16_t packetId);
+
+ private:
+  ModbusCacheItem _items[MB_NUMBER_CACHE_ITEMS];
+  uint8_t _numberItems;
+  SemaphoreHandle_t _lock;
+};
+
+}  // namespace esp32ModbusTCPInternals
+
+#endif
@@ -87,13 +87,57 @@ uint16_t ModbusRequest::getId() {
   return _packetId;
 }
 
+esp32Modbus::FunctionCode ModbusRequest::getFunctionCode() {
+  return static_cast<esp32Modbus::FunctionCode>(_functionCode);
+}
+
+uint16_t ModbusRequest::getAddress() {
+  return _address;
+}
+
+uint16_t ModbusRequest::getByteCount() {
+  return _byteCount;
+}
+
+uint8_t ModbusRequest::getCommRetries() {
+  return _commRetries;
+}
+
+uint8_t ModbusRequest::getBusyRetries() {
+  return _busyRetries;
+}
+
+esp32Modbus::Error ModbusRequest::getRetryError() {
+  return _retryError;
+}
+
+void ModbusRequest::retry(esp32Modbus::Error error, uint32_t now, uint32_t delay) {
+  if (error == esp32Modbus::SERVER_DEVICE_BUSY || error == esp32Modbus::ACKNOWLEDGE) {
+    ++_busyRetries;
+  } else {
+    ++_commRetries;
+  }
+  _retryError = error;
+  _retryMillis = now;
+  _retryDelay = delay;
+}
+
+bool ModbusRequest::isDue(uint32_t now) {
+  return (now - _retryMillis >= _retryDelay);  // safe for millis() rollover
+}
+
 ModbusRequest::ModbusRequest(size_t length) :
   ModbusMessage(nullptr, length),  // buffer will be set in constructor body
   _packetId(0),
   _slaveAddress(0),
   _functionCode(0),
   _address(0),
-  _byteCount(0) {
+  _byteCount(0),
+  _commRetries(0),
+  _busyRetries(0),
+  _retryError(esp32Modbus::SUCCES),
+  _retryMillis(0),
+  _retryDelay(0) {
     _buffer = new uint8_t[length];
     _packetId = ++_lastPacketId;
     if (_lastPacketId == 0) _lastPacketId = 1;
@@ -180,12 +224,39 @@ ModbusResponse::ModbusResponse(uint8_t* data, size_t length, ModbusRequest* requ
 
 bool ModbusResponse::isComplete() {
   if (_index == _request->responseLength()) return true;
+  if (_index == 9 && (_buffer[7] & 0x80)) return true;  // exception response
   return false;
 }
 
 bool ModbusResponse::isSucces() {
-  if (_request->_packetId != make_word(_buffer[0], _buffer[1])) return false;
-  if (_request->_functionCode != _buffer[7]) return false;
+  if (_request->_packetId != make_word(_buffer[0], _buffer[1])) {
+    _error = esp32Modbus::COMM_ERROR;
+    return false;
+  }
+  if ((_request->_functionCode | 0x80) == _buffer[7]) {  // exception code is in first data byte
+    switch (_buffer[8]) {
+    case esp32Modbus::ILLEGAL_FUNCTION:
+    case esp32Modbus::ILLEGAL_DATA_ADDRESS:
+    case esp32Modbus::ILLEGAL_DATA_VALUE:
+    case esp32Modbus::SERVER_DEVICE_FAILURE:
+    case esp32Modbus::ACKNOWLEDGE:
+    case esp32Modbus::SERVER_DEVICE_BUSY:
+    case esp32Modbus::NEGATIVE_ACKNOWLEDGE:
+    case esp32Modbus::MEMORY_PARITY_ERROR:
+    case esp32Modbus::GATEWAY_PATH_UNAVAIL:
+    case esp32Modbus::GATEWAY_TARGET_FAIL:
+      _error = static_cast<esp32Modbus::Error>(_buffer[8]);
+      break;
+    default:  // unknown or vendor specific exception
+      _error = esp32Modbus::COMM_ERROR;
+      break;
+    }
+    return false;
+  }
+  if (_request->_functionCode != _buffer[7]) {
+    _error = esp32Modbus::INVALID_FUNCTION;
+    return false;
+  }
   return true;
 }
 
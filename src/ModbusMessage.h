@@ -54,7 +54,15 @@ class ModbusRequest : public ModbusMessage {
  public:
   ~ModbusRequest();
   uint16_t getId();
+  esp32Modbus::FunctionCode getFunctionCode();
+  uint16_t getAddress();
+  uint16_t getByteCount();
   virtual size_t responseLength() = 0;
+  uint8_t getCommRetries();
+  uint8_t getBusyRetries();
+  esp32Modbus::Error getRetryError();
+  void retry(esp32Modbus::Error error, uint32_t now, uint32_t delay);  // delay in msecs before request is due again
+  bool isDue(uint32_t now);
 
  protected:
   explicit ModbusRequest(size_t length);
@@ -64,6 +72,11 @@ class ModbusRequest : public ModbusMessage {
   uint8_t _functionCode;
   uint16_t _address;
   uint16_t _byteCount;
+  uint8_t _commRetries;
+  uint8_t _busyRetries;
+  esp32Modbus::Error _retryError;
+  uint32_t _retryMillis;
+  uint32_t _retryDelay;
 };
 
 // read discrete coils
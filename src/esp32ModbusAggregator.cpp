@@ -0,0 +1,197 @@
+/* esp32ModbusAggregator
+
+Copyright 2018 Bert Melis
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <stdio.h>  // for snprintf
+#include <inttypes.h>  // for PRIu32
+
+#include "esp32ModbusAggregator.h"
+
+esp32ModbusAggregator::esp32ModbusAggregator(uint32_t windowTime) :
+  _windowTime(windowTime),
+  _numberRegisters(0),
+  _registers(),
+  _lock(nullptr) {
+    _lock = xSemaphoreCreateMutex();
+  }
+
+esp32ModbusAggregator::~esp32ModbusAggregator() {
+  vSemaphoreDelete(_lock);
+}
+
+bool esp32ModbusAggregator::addRegister(uint8_t serverID, esp32Modbus::FunctionCode fc, uint16_t address, ValueType type) {
+  if (fc != esp32Modbus::READ_HOLD_REGISTER && fc != esp32Modbus::READ_INPUT_REGISTER) return false;
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  if (_numberRegisters == MB_AGGREGATOR_REGISTERS) {
+    xSemaphoreGive(_lock);
+    return false;
+  }
+  Register* reg = &_registers[_numberRegisters];
+  reg->serverID = serverID;
+  reg->fc = fc;
+  reg->address = address;
+  reg->type = type;
+  reg->head = 0;
+  for (uint8_t i = 0; i < MB_AGGREGATOR_WINDOWS; ++i) {
+    reg->windows[i].count = 0;
+  }
+  ++_numberRegisters;  // only visible to add() when completely set up
+  xSemaphoreGive(_lock);
+  return true;
+}
+
+void esp32ModbusAggregator::add(uint8_t serverID, esp32Modbus::FunctionCode fc, uint16_t address, uint8_t* data, uint16_t length, uint32_t now) {
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  for (uint8_t i = 0; i < _numberRegisters; ++i) {
+    Register* reg = &_registers[i];
+    if (reg->serverID != serverID || reg->fc != fc || reg->address < address) continue;
+    size_t offset = (reg->address - address) * 2;  // register is 2 bytes wide
+    size_t size = (reg->type == UINT32 || reg->type == INT32) ? 4 : 2;
+    if (offset + size > length) continue;
+    uint8_t* d = &data[offset];
+    switch (reg->type) {
+    case UINT16:
+      _addValue(reg, static_cast<uint16_t>((d[0] << 8) | d[1]), now);
+      break;
+    case INT16:
+      _addValue(reg, static_cast<int16_t>((d[0] << 8) | d[1]), now);
+      break;
+    case UINT32:
+      _addValue(reg, static_cast<uint32_t>((static_cast<uint32_t>(d[0]) << 24) | (static_cast<uint32_t>(d[1]) << 16) | (d[2] << 8) | d[3]), now);
+      break;
+    case INT32:
+      _addValue(reg, static_cast<int32_t>((static_cast<uint32_t>(d[0]) << 24) | (static_cast<uint32_t>(d[1]) << 16) | (d[2] << 8) | d[3]), now);
+      break;
+    }
+  }
+  xSemaphoreGive(_lock);
+}
+
+void esp32ModbusAggregator::_addValue(Register* reg, int64_t value, uint32_t now) {
+  Window* w = &reg->windows[reg->head];
+  if (w->count > 0 && (now - w->timestamp >= _windowTime || w->count == UINT16_MAX)) {
+    // start new window, overwriting the oldest
+    reg->head = (reg->head + 1) % MB_AGGREGATOR_WINDOWS;
+    w = &reg->windows[reg->head];
+    w->count = 0;
+  }
+  if (w->count == 0) {
+    w->timestamp = now;
+    w->sum = 0;
+    w->min = value;
+    w->max = value;
+  }
+  ++w->count;
+  w->sum += value;
+  if (value < w->min) w->min = value;
+  if (value > w->max) w->max = value;
+  w->last = value;
+}
+
+/* Binary records are big endian, oldest window first:
+   server ID (1), address (2), function code (1), value type (1), timestamp (4),
+   count (2), min (4), max (4), last (4), sum (8).
+   min, max and last hold the raw register value. */
+size_t esp32ModbusAggregator::exportBinary(uint8_t* buffer, size_t length, bool clear) {
+  size_t index = 0;
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  bool full = false;
+  for (uint8_t i = 0; i < _numberRegisters && !full; ++i) {
+    Register* reg = &_registers[i];
+    for (uint8_t j = 1; j <= MB_AGGREGATOR_WINDOWS && !full; ++j) {
+      Window* w = &reg->windows[(reg->head + j) % MB_AGGREGATOR_WINDOWS];
+      if (w->count == 0) continue;
+      if (index + MB_AGGREGATOR_RECORD_SIZE > length) {
+        full = true;
+        continue;
+      }
+      uint8_t* b = &buffer[index];
+      b[0] = reg->serverID;
+      b[1] = reg->address >> 8;
+      b[2] = reg->address;
+      b[3] = reg->fc;
+      b[4] = reg->type;
+      for (uint8_t k = 0; k < 4; ++k) {
+        b[5 + k] = w->timestamp >> (24 - k * 8);
+        b[11 + k] = w->min >> (24 - k * 8);
+        b[15 + k] = w->max >> (24 - k * 8);
+        b[19 + k] = w->last >> (24 - k * 8);
+      }
+      b[9] = w->count >> 8;
+      b[10] = w->count;
+      for (uint8_t k = 0; k < 8; ++k) {
+        b[23 + k] = w->sum >> (56 - k * 8);
+      }
+      index += MB_AGGREGATOR_RECORD_SIZE;
+      if (clear) w->count = 0;
+    }
+  }
+  xSemaphoreGive(_lock);
+  return index;
+}
+
+// one line per window: serverID,address,fc,timestamp,count,min,max,avg,last
+size_t esp32ModbusAggregator::exportCSV(char* buffer, size_t length, bool clear) {
+  if (length == 0) return 0;
+  buffer[0] = '\0';  // output is a valid string, even when nothing is exported
+  size_t index = 0;
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  bool full = false;
+  for (uint8_t i = 0; i < _numberRegisters && !full; ++i) {
+    Register* reg = &_registers[i];
+    for (uint8_t j = 1; j <= MB_AGGREGATOR_WINDOWS && !full; ++j) {
+      Window* w = &reg->windows[(reg->head + j) % MB_AGGREGATOR_WINDOWS];
+      if (w->count == 0) continue;
+      int written = snprintf(&buffer[index], length - index, "%u,%u,%u,%" PRIu32 ",%u,%lld,%lld,%.2f,%lld\n",
+                             reg->serverID,
+                             reg->address,
+                             reg->fc,
+                             w->timestamp,
+                             w->count,
+                             static_cast<long long>(w->min),  // NOLINT(runtime/int)
+                             static_cast<long long>(w->max),  // NOLINT(runtime/int)
+                             static_cast<double>(w->sum) / w->count,
+                             static_cast<long long>(w->last));  // NOLINT(runtime/int)
+      if (written < 0 || index + written >= length) {
+        buffer[index] = '\0';  // don't export incomplete lines
+        full = true;
+        continue;
+      }
+      index += written;
+      if (clear) w->count = 0;
+    }
+  }
+  xSemaphoreGive(_lock);
+  return index;
+}
+
+void esp32ModbusAggregator::clear() {
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  for (uint8_t i = 0; i < _numberRegisters; ++i) {
+    _registers[i].head = 0;
+    for (uint8_t j = 0; j < MB_AGGREGATOR_WINDOWS; ++j) {
+      _registers[i].windows[j].count = 0;
+    }
+  }
+  xSemaphoreGive(_lock);
+}
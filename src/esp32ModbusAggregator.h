@@ -0,0 +1,87 @@
+/* esp32ModbusAggregator
+
+Copyright 2018 Bert Melis
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef esp32ModbusAggregator_h
+#define esp32ModbusAggregator_h
+
+#include <stdint.h>  // for uint*_t
+#include <stddef.h>  // for size_t
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include "esp32ModbusTypeDefs.h"
+
+#ifndef MB_AGGREGATOR_REGISTERS
+#define MB_AGGREGATOR_REGISTERS 16  // number of registers that can be aggregated
+#endif
+#ifndef MB_AGGREGATOR_WINDOWS
+#define MB_AGGREGATOR_WINDOWS 4  // number of windows kept per register
+#endif
+#define MB_AGGREGATOR_RECORD_SIZE 31  // bytes per window in binary export
+
+class esp32ModbusAggregator {
+ public:
+  enum ValueType : uint8_t {
+    UINT16 = 0x00,
+    INT16  = 0x01,
+    UINT32 = 0x02,  // 2 registers, high word first
+    INT32  = 0x03   // 2 registers, high word first
+  };
+  explicit esp32ModbusAggregator(uint32_t windowTime = 60000);
+  ~esp32ModbusAggregator();
+  esp32ModbusAggregator(const esp32ModbusAggregator&) = delete;
+  esp32ModbusAggregator& operator=(const esp32ModbusAggregator&) = delete;
+  bool addRegister(uint8_t serverID, esp32Modbus::FunctionCode fc, uint16_t address, ValueType type);
+  void add(uint8_t serverID, esp32Modbus::FunctionCode fc, uint16_t address, uint8_t* data, uint16_t length, uint32_t now);
+  // when clear is true, exported windows are reset in the same step so no samples get lost
+  size_t exportBinary(uint8_t* buffer, size_t length, bool clear = false);
+  size_t exportCSV(char* buffer, size_t length, bool clear = false);
+  void clear();
+
+ private:
+  struct Window {
+    uint32_t timestamp;  // millis() of first sample
+    uint16_t count;
+    int64_t sum;
+    int64_t min;
+    int64_t max;
+    int64_t last;
+  };
+  struct Register {
+    uint8_t serverID;
+    esp32Modbus::FunctionCode fc;
+    uint16_t address;
+    ValueType type;
+    uint8_t head;  // index of current window
+    Window windows[MB_AGGREGATOR_WINDOWS];
+  };
+  void _addValue(Register* reg, int64_t value, uint32_t now);
+  const uint32_t _windowTime;
+  uint8_t _numberRegisters;
+  Register _registers[MB_AGGREGATOR_REGISTERS];
+  SemaphoreHandle_t _lock;
+};
+
+#endif
@@ -36,7 +36,11 @@ esp32ModbusTCP::esp32ModbusTCP(uint8_t serverID, IPAddress addr, uint16_t port)
   _port(port),
   _onDataHandler(nullptr),
   _onErrorHandler(nullptr),
-  _queue() {
+  _aggregator(nullptr),
+  _cache(),
+  _queue(),
+  _cacheQueue(),
+  _queueLock(nullptr) {
     _client.onConnect(_onConnected, this);
     _client.onDisconnect(_onDisconnected, this);
     _client.onError(_onError, this);
@@ -46,6 +50,8 @@ esp32ModbusTCP::esp32ModbusTCP(uint8_t serverID, IPAddress addr, uint16_t port)
     _client.setNoDelay(true);
     _client.setAckTimeout(5000);
     _queue = xQueueCreate(MB_NUMBER_QUEUE_ITEMS, sizeof(esp32ModbusTCPInternals::ModbusRequest*));
+    _cacheQueue = xQueueCreate(MB_NUMBER_QUEUE_ITEMS, sizeof(esp32ModbusTCPInternals::ModbusCacheReply));
+    _queueLock = xSemaphoreCreateRecursiveMutex();
   }
 
 esp32ModbusTCP::~esp32ModbusTCP() {
@@ -54,6 +60,8 @@ esp32ModbusTCP::~esp32ModbusTCP() {
     delete req;
   }
   vQueueDelete(_queue);
+  vQueueDelete(_cacheQueue);
+  vSemaphoreDelete(_queueLock);
 }
 
 void esp32ModbusTCP::onData(esp32Modbus::MBTCPOnData handler) {
@@ -64,6 +72,10 @@ void esp32ModbusTCP::onError(esp32Modbus::MBTCPOnError handler) {
   _onErrorHandler = handler;
 }
 
+void esp32ModbusTCP::setAggregator(esp32ModbusAggregator* aggregator) {
+  _aggregator = aggregator;
+}
+
 uint16_t esp32ModbusTCP::readDiscreteInputs(uint16_t address, uint16_t numberInputs) {
   esp32ModbusTCPInternals::ModbusRequest* request =
     new esp32ModbusTCPInternals::ModbusRequest02(_serverID, address, numberInputs);
@@ -82,13 +94,62 @@ uint16_t esp32ModbusTCP::readInputRegisters(uint16_t address, uint16_t numberReg
   return _addToQueue(request);
 }
 
+bool esp32ModbusTCP::cacheHoldingRegisters(uint16_t address, uint16_t numberRegisters, uint32_t ttl) {
+  return _cache.add(esp32Modbus::READ_HOLD_REGISTER, address, numberRegisters * 2, ttl);
+}
+
+bool esp32ModbusTCP::cacheInputRegisters(uint16_t address, uint16_t numberRegisters, uint32_t ttl) {
+  return _cache.add(esp32Modbus::READ_INPUT_REGISTER, address, numberRegisters * 2, ttl);
+}
+
+bool esp32ModbusTCP::readCachedHoldingRegisters(uint16_t address, uint16_t numberRegisters, uint8_t* buffer) {
+  return _readCached(esp32Modbus::READ_HOLD_REGISTER, address, numberRegisters, buffer);
+}
+
+bool esp32ModbusTCP::readCachedInputRegisters(uint16_t address, uint16_t numberRegisters, uint8_t* buffer) {
+  return _readCached(esp32Modbus::READ_INPUT_REGISTER, address, numberRegisters, buffer);
+}
+
+bool esp32ModbusTCP::_readCached(esp32Modbus::FunctionCode fc, uint16_t address, uint16_t numberRegisters, uint8_t* buffer) {
+  esp32ModbusTCPInternals::ModbusCacheItem* item = _cache.find(fc, address, numberRegisters * 2);
+  if (!item) return false;
+  return _cache.copyFresh(item, buffer, millis());
+}
+
 uint16_t esp32ModbusTCP::_addToQueue(esp32ModbusTCPInternals::ModbusRequest* request) {
+  esp32ModbusTCPInternals::ModbusCacheItem* item =
+    _cache.find(request->getFunctionCode(), request->getAddress(), request->getByteCount());
+  if (item) {
+    uint16_t packetId = request->getId();
+    // cached replies are delivered from the AsyncTCP task, which only polls while connected
+    bool allowFresh = (_state == IDLE || _state == WAITING);
+    switch (_cache.attach(item, &packetId, millis(), allowFresh)) {
+    case esp32ModbusTCPInternals::ModbusCache::FRESH:
+      {
+      esp32ModbusTCPInternals::ModbusCacheReply reply = {packetId, item};
+      delete request;
+      if (xQueueSend(_cacheQueue, &reply, (TickType_t) 10) == pdPASS) {
+        log_v("cached");
+        _processQueue();  // make sure there is a connection to deliver the reply
+        return packetId;
+      }
+      return 0;
+      }
+    case esp32ModbusTCPInternals::ModbusCache::PENDING:  // identical request already in queue
+      delete request;
+      return packetId;
+    case esp32ModbusTCPInternals::ModbusCache::MISS:
+      break;
+    }
+  }
   if (uxQueueSpacesAvailable(_queue) > 0) {
+    uint16_t packetId = request->getId();  // request is owned by the queue from here on
     if (xQueueSend(_queue, &request, (TickType_t) 10) == pdPASS) {
       _processQueue();
-      return request->getId();
+      return packetId;
     }
   }
+  if (item) _cache.release(request->getId());
   delete request;
   return 0;
 }
@@ -115,6 +176,7 @@ void esp32ModbusTCP::_onConnected(void* mb, AsyncClient* client) {
   esp32ModbusTCP* o = reinterpret_cast<esp32ModbusTCP*>(mb);
   o->_state = IDLE;
   o->_lastMillis = millis();
+  o->_processCache();
   o->_processQueue();
 }
 
@@ -123,6 +185,7 @@ void esp32ModbusTCP::_onDisconnected(void* mb, AsyncClient* client) {
   esp32ModbusTCP* o = reinterpret_cast<esp32ModbusTCP*>(mb);
   o->_state = NOTCONNECTED;
   o->_lastMillis = millis();
+  o->_processCache();
   o->_processQueue();
 }
 
@@ -167,43 +230,89 @@ void esp32ModbusTCP::_onData(void* mb, AsyncClient* client, void* data, size_t l
 
 void esp32ModbusTCP::_onPoll(void* mb, AsyncClient* client) {
   esp32ModbusTCP* o = static_cast<esp32ModbusTCP*>(mb);
+  o->_processCache();
   if (millis() - o->_lastMillis > MB_IDLE_DICONNECT_TIME) {
     log_v("idle time disconnecting");
     o->_disconnect();
+  } else if (o->_state == IDLE) {
+    o->_processQueue();  // send requests that were backing off
   }
 }
 
 void esp32ModbusTCP::_processQueue() {
-  if (_state == NOTCONNECTED && uxQueueMessagesWaiting(_queue) > 0) {
+  // called from both the application and the AsyncTCP task
+  xSemaphoreTakeRecursive(_queueLock, portMAX_DELAY);
+  _sendNext();
+  xSemaphoreGiveRecursive(_queueLock);
+}
+
+void esp32ModbusTCP::_sendNext() {
+  if (_state == NOTCONNECTED &&
+      (uxQueueMessagesWaiting(_queue) > 0 || uxQueueMessagesWaiting(_cacheQueue) > 0)) {
     _connect();
     return;
   }
   if (_state == CONNECTING ||
       _state == WAITING ||
       _state == DISCONNECTING ||
-      uxQueueSpacesAvailable(_queue) == 0 ||
+      uxQueueMessagesWaiting(_queue) == 0 ||
       !_client.canSend()) {
     return;
   }
   esp32ModbusTCPInternals::ModbusRequest* req = nullptr;
-  if (xQueuePeek(_queue, &req, (TickType_t)20)) {
-    _state = WAITING;
-    log_v("send");
-    _client.add(reinterpret_cast<char*>(req->getMessage()), req->getSize());
-    _client.send();
-    _lastMillis = millis();
+  UBaseType_t items = uxQueueMessagesWaiting(_queue);
+  while (items-- > 0 && _state == IDLE && xQueuePeek(_queue, &req, (TickType_t)20)) {
+    if (req->isDue(millis())) {
+      _state = WAITING;
+      log_v("send");
+      _client.add(reinterpret_cast<char*>(req->getMessage()), req->getSize());
+      _client.send();
+      _lastMillis = millis();
+      return;
+    }
+    // request is backing off: move it to the back so the others can go first
+    if (!xQueueReceive(_queue, &req, (TickType_t)20)) return;
+    if (xQueueSend(_queue, &req, (TickType_t)20) != pdPASS) {
+      // slot was taken by a new request in the meantime
+      log_w("could not requeue");
+      _cache.release(req->getId());
+      if (_onErrorHandler) _onErrorHandler(req->getId(), req->getRetryError());
+      delete req;
+    }
+  }
+}
+
+void esp32ModbusTCP::_processCache() {
+  esp32ModbusTCPInternals::ModbusCacheReply reply;
+  uint8_t data[MB_CACHE_MAX_BYTES];
+  while (xQueueReceive(_cacheQueue, &reply, (TickType_t)0)) {
+    size_t length = _cache.copy(reply.item, data);
+    if (_onDataHandler) _onDataHandler(reply.packetId, _serverID, reply.item->functionCode, data, length);
   }
 }
 
 void esp32ModbusTCP::_tryError(esp32Modbus::Error error) {
   esp32ModbusTCPInternals::ModbusRequest* req = nullptr;
   if (xQueuePeek(_queue, &req, (TickType_t)10)) {
+    if (_tryRetry(req, error)) return;
+    _cache.release(req->getId());
     if (_onErrorHandler) _onErrorHandler(req->getId(), error);
   }
   _next();
 }
 
 void esp32ModbusTCP::_tryData(esp32ModbusTCPInternals::ModbusResponse* response) {
+  esp32ModbusTCPInternals::ModbusRequest* req = nullptr;
+  if (_aggregator && xQueuePeek(_queue, &req, (TickType_t)10)) {
+    _aggregator->add(
+      response->getSlaveAddress(),
+      response->getFunctionCode(),
+      req->getAddress(),
+      response->getData(),
+      response->getByteCount(),
+      millis());
+  }
+  _cache.store(response->getId(), response->getData(), response->getByteCount(), millis());
   if (_onDataHandler) _onDataHandler(
       response->getId(),
       response->getSlaveAddress(),
@@ -213,6 +322,26 @@ void esp32ModbusTCP::_tryData(esp32ModbusTCPInternals::ModbusResponse* response)
   _next();
 }
 
+bool esp32ModbusTCP::_tryRetry(esp32ModbusTCPInternals::ModbusRequest* request, esp32Modbus::Error error) {
+  if (error == esp32Modbus::COMM_ERROR && request->getCommRetries() < MB_COMM_ERROR_RETRIES) {
+    log_v("retrying");
+    request->retry(error, millis(), 0);
+  } else if ((error == esp32Modbus::SERVER_DEVICE_BUSY || error == esp32Modbus::ACKNOWLEDGE) &&
+             request->getBusyRetries() < MB_BUSY_RETRIES) {
+    log_v("server busy, backing off");
+    uint8_t shift = request->getBusyRetries();
+    if (shift > MB_BUSY_BACKOFF_MAX_SHIFT) shift = MB_BUSY_BACKOFF_MAX_SHIFT;
+    request->retry(error, millis(), static_cast<uint32_t>(MB_BUSY_BACKOFF_TIME) << shift);
+  } else {
+    return false;
+  }
+  // keep request in queue, it will be sent again when due
+  _lastMillis = millis();
+  _state = _client.connected() ? IDLE : NOTCONNECTED;
+  _processQueue();
+  return true;
+}
+
 void esp32ModbusTCP::_next() {
   esp32ModbusTCPInternals::ModbusRequest* req = nullptr;
   if (xQueueReceive(_queue, &req, (TickType_t)20)) {
@@ -220,5 +349,6 @@ void esp32ModbusTCP::_next() {
   }
   _lastMillis = millis();
   _state = IDLE;
+  _processCache();
   _processQueue();
 }
@@ -32,9 +32,12 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include <esp32-hal-log.h>  // for millis()
 #include <freertos/queue.h>
+#include <freertos/semphr.h>
 
 #include "esp32ModbusTypeDefs.h"
 #include "ModbusMessage.h"
+#include "ModbusCache.h"
+#include "esp32ModbusAggregator.h"
 
 #ifndef MB_NUMBER_QUEUE_ITEMS
 #define MB_NUMBER_QUEUE_ITEMS 20  // size of queue (items)
@@ -42,6 +45,16 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #ifndef MB_IDLE_DICONNECT_TIME
 #define MB_IDLE_DICONNECT_TIME 60000  // msecs before an idle conenction will be closed
 #endif
+#ifndef MB_COMM_ERROR_RETRIES
+#define MB_COMM_ERROR_RETRIES 1  // immediate retries after a communication error
+#endif
+#ifndef MB_BUSY_RETRIES
+#define MB_BUSY_RETRIES 3  // retries after a busy or acknowledge exception
+#endif
+#ifndef MB_BUSY_BACKOFF_TIME
+#define MB_BUSY_BACKOFF_TIME 500  // msecs before first busy retry, doubled on every next retry
+#endif
+#define MB_BUSY_BACKOFF_MAX_SHIFT 10  // backoff time stops doubling after this many retries
 
 class esp32ModbusTCP {
  public:
@@ -49,12 +62,18 @@ class esp32ModbusTCP {
   ~esp32ModbusTCP();
   void onData(esp32Modbus::MBTCPOnData handler);
   void onError(esp32Modbus::MBTCPOnError handler);
+  void setAggregator(esp32ModbusAggregator* aggregator);
   uint16_t readDiscreteInputs(uint16_t address, uint16_t numberInputs);
   uint16_t readHoldingRegisters(uint16_t address, uint16_t numberRegisters);
   uint16_t readInputRegisters(uint16_t address, uint16_t numberRegisters);
+  bool cacheHoldingRegisters(uint16_t address, uint16_t numberRegisters, uint32_t ttl);
+  bool cacheInputRegisters(uint16_t address, uint16_t numberRegisters, uint32_t ttl);
+  bool readCachedHoldingRegisters(uint16_t address, uint16_t numberRegisters, uint8_t* buffer);
+  bool readCachedInputRegisters(uint16_t address, uint16_t numberRegisters, uint8_t* buffer);
 
  private:
   uint16_t _addToQueue(esp32ModbusTCPInternals::ModbusRequest* request);
+  bool _readCached(esp32Modbus::FunctionCode fc, uint16_t address, uint16_t numberRegisters, uint8_t* buffer);
 
   AsyncClient _client;
   void _connect();
@@ -66,8 +85,11 @@ class esp32ModbusTCP {
   static void _onData(void* mb, AsyncClient* client, void* data, size_t length);
   static void _onPoll(void* mb, AsyncClient* client);
   void _processQueue();
+  void _sendNext();
+  void _processCache();
   void _tryError(esp32Modbus::Error error);
   void _tryData(esp32ModbusTCPInternals::ModbusResponse* response);
+  bool _tryRetry(esp32ModbusTCPInternals::ModbusRequest* request, esp32Modbus::Error error);
   void _next();
   uint32_t _lastMillis;
   enum {
@@ -82,7 +104,11 @@ class esp32ModbusTCP {
   const uint16_t _port;
   esp32Modbus::MBTCPOnData _onDataHandler;
   esp32Modbus::MBTCPOnError _onErrorHandler;
+  esp32ModbusAggregator* _aggregator;
+  esp32ModbusTCPInternals::ModbusCache _cache;
   QueueHandle_t _queue;
+  QueueHandle_t _cacheQueue;
+  SemaphoreHandle_t _queueLock;
 };
 
 #endif
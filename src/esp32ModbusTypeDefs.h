@@ -51,6 +51,8 @@ enum Error : uint8_t {
   SERVER_DEVICE_BUSY    = 0x06,
   NEGATIVE_ACKNOWLEDGE  = 0x07,
   MEMORY_PARITY_ERROR   = 0x08,
+  GATEWAY_PATH_UNAVAIL  = 0x0A,
+  GATEWAY_TARGET_FAIL   = 0x0B,
   TIMEOUT               = 0xE0,
   INVALID_SLAVE         = 0xE1,
   INVALID_FUNCTION      = 0xE2,